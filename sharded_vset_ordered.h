@@ -0,0 +1,436 @@
+#ifndef SHARDED_VSET_ORDERED_H
+#define SHARDED_VSET_ORDERED_H
+
+#include "vset_ordered.h"
+#include "vset_hash.h"
+#include <functional>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+
+namespace sortedvector {
+
+// A set partitioned across a number of vset_ordered shards, each with
+// its own lock, so that concurrent writers to different shards do not
+// serialize and each insert only shifts the keys of one shard.
+//
+// By range (the default), shard i holds the keys k with
+// split[i-1] <= k < split[i].  A set constructed with only a shard count
+// has no split points, so until the first rebalance every key (and every
+// writer) goes to the first shard.  Give initial split points if the key
+// distribution is known in advance.
+//
+// By hash, a key's shard follows from its std::hash.  The shards then
+// stay even whatever the keys, which suits skewed or monotonic keys
+// (timestamps, say) that would all land in one shard of a range
+// partition; no rebalancing is needed, but ordered iteration has to
+// merge the shards.
+//
+// Writers share no written state: an operation finds its shard from
+// the split points (read without a lock), locks that shard and checks
+// that the key is still within the shard's bounds, which only change
+// under the shard's lock, retrying if a rebalance moved them in between.
+// Each shard's size counter sits with its lock, and shards are padded
+// apart so that they share no cache lines.
+//
+// Rebalancing (by range only) recomputes the split points as quantiles
+// of the shard sizes and moves keys across each boundary in turn, between
+// the two neighbouring shards only and holding just their locks, so
+// writers to the other shards carry on.  It is triggered when an insert
+// leaves a shard of at least minsize keys threshold times larger than
+// the smallest shard was at the last rebalance.  Under monotonic keys
+// every boundary moves at each rebalance (O(n) work whenever the newest
+// shard doubles): partition those by hash instead.
+//
+// Replaced split points are only freed when the set is destroyed, since
+// a writer may still be reading one: one key per boundary moved.
+//
+// Iteration (for_each) walks the shards in order, locking one at a time
+// (by hash, all of them, to merge): it sees keys in global order, but is
+// not a snapshot of the whole set if writers are running concurrently.
+
+template<typename Key, typename Compare = std::less<Key>,
+		typename Allocator = std::allocator<Key>>
+class sharded_vset_ordered {
+public:
+	using shard_type = vset_ordered<Key,Compare,Allocator>;
+	using key_type = Key;
+	using value_type = Key;
+	using size_type = typename shard_type::size_type;
+	using key_compare = Compare;
+	using value_compare = Compare;
+	using allocator_type = Allocator;
+
+	using mytype = sharded_vset_ordered<Key,Compare,Allocator>;
+
+	enum partition {
+		by_range, // ordered shards, rebalanced as the keys drift
+		by_hash   // shards chosen by std::hash<Key>
+	};
+
+	// constructors:
+	explicit sharded_vset_ordered(size_type nshards = defaultshards(),
+			partition p = by_range, const Compare &comp = Compare(),
+			const Allocator &alloc = Allocator())
+					: _comp(comp), _partition(p) {
+		if (p==by_hash && !is_hashable<Key>::value)
+			throw std::invalid_argument(
+				"sharded_vset_ordered: partitioning by hash needs std::hash");
+		init(nshards<1 ? 1 : nshards,alloc);
+	}
+
+	// start with known split points (partitioned by range, one shard
+	// per interval)
+	explicit sharded_vset_ordered(std::vector<Key> splits,
+			const Compare &comp = Compare(),
+			const Allocator &alloc = Allocator())
+					: _comp(comp), _partition(by_range) {
+		std::sort(splits.begin(),splits.end(),_comp);
+		init(splits.size()+1,alloc);
+		for(size_type i=0;i<splits.size();i++)
+			setsplit(i,std::move(splits[i]));
+	}
+
+	sharded_vset_ordered(const mytype &) = delete;
+	mytype &operator=(const mytype &) = delete;
+
+	// destructor:
+	~sharded_vset_ordered() = default;
+
+	// other functions:
+	key_compare key_comp() const { return _comp; }
+	value_compare value_comp() const { return _comp; }
+
+	size_type shard_count() const { return _shards.size(); }
+	partition partitioning() const { return _partition; }
+
+	size_type count(const Key &key) const {
+		std::unique_lock<std::mutex> l;
+		return lockshard(key,l).s.count(key);
+	}
+
+	bool contains(const Key &key) const { return count(key)!=0; }
+
+	// size functions:
+
+	bool empty() const { return size()==0; }
+
+	// (sums the shards' counters, so only a snapshot while writers run)
+	size_type size() const {
+		size_type n = 0;
+		for(auto &s : _shards) n += s->n.load(std::memory_order_relaxed);
+		return n;
+	}
+
+	// insert & erase:
+
+	bool insert(const value_type &value) {
+		return insert_impl(value);
+	}
+
+	bool insert(value_type &&value) {
+		return insert_impl(std::move(value));
+	}
+
+	template<typename inputit>
+	void insert(inputit first, inputit last) {
+		for(;first!=last;++first) insert(*first);
+	}
+
+	void insert(std::initializer_list<value_type> ilist) {
+		for(auto &&x : ilist) insert(x);
+	}
+
+	size_type erase(const key_type &key) {
+		std::unique_lock<std::mutex> l;
+		shard &s = lockshard(key,l);
+		size_type n = s.s.erase(key);
+		s.n.store(s.s.size(),std::memory_order_relaxed);
+		return n;
+	}
+
+	// (keeps the split points)
+	void clear() {
+		std::vector<std::unique_lock<std::mutex>> locks;
+		lockall(locks);
+		for(auto &s : _shards) {
+			s->s.clear();
+			s->n.store(0,std::memory_order_relaxed);
+		}
+	}
+
+	// iteration (in key order):
+
+	template<typename F>
+	F for_each(F f) const {
+		if (_partition==by_hash) return merge_each(f);
+		// (holding off rebalancing, so no key changes shard meanwhile)
+		std::lock_guard<std::mutex> rl(_rebalancing);
+		for(auto &s : _shards) {
+			std::lock_guard<std::mutex> sl(s->m);
+			for(auto &x : s->s) f(x);
+		}
+		return f;
+	}
+
+	std::vector<Key> to_vector() const {
+		std::vector<Key> ret;
+		ret.reserve(size());
+		for_each([&ret](const Key &k) { ret.push_back(k); });
+		return ret;
+	}
+
+	// rebalancing (by range only):
+
+	// a shard of at least minsize keys and more than threshold times
+	// the smallest shard's size at the last rebalance triggers a
+	// rebalance; threshold<=1 disables it
+	void set_rebalance(double threshold, size_type minsize = 4096) {
+		_threshold.store(threshold,std::memory_order_relaxed);
+		_minsize.store(minsize,std::memory_order_relaxed);
+	}
+
+	// move split points so that each shard holds an equal share of the
+	// current keys
+	void rebalance() {
+		std::lock_guard<std::mutex> l(_rebalancing);
+		rebalance_locked(true);
+	}
+
+	std::vector<Key> split_points() const {
+		std::lock_guard<std::mutex> l(_rebalancing);
+		std::vector<Key> ret;
+		for(auto &p : _splits) {
+			const Key *k = p.load(std::memory_order_acquire);
+			if (k) ret.push_back(*k);
+		}
+		return ret;
+	}
+
+protected:
+
+	static constexpr std::size_t cacheline = 64;
+
+	// (padded rather than aligned: alignas would need C++17's aligned
+	// operator new to take effect on the heap)
+	struct shard {
+		shard(const Compare &comp, const Allocator &alloc)
+			: s(comp,alloc), n(0) {}
+		char pad0[cacheline];
+		mutable std::mutex m;
+		shard_type s;
+		std::atomic<size_type> n; // s.size(), readable without m
+		char pad1[cacheline];
+	};
+
+	static size_type defaultshards() {
+		size_type n = std::thread::hardware_concurrency();
+		return n ? n : 1;
+	}
+
+	void init(size_type nshards, const Allocator &alloc) {
+		for(size_type i=0;i<nshards;i++)
+			_shards.emplace_back(new shard(_comp,alloc));
+		std::vector<std::atomic<const Key *>> splits(nshards-1);
+		for(auto &p : splits) p.store(nullptr,std::memory_order_relaxed);
+		_splits.swap(splits);
+	}
+
+	// is key below split point i?  (a missing split point is above
+	// every key, so the shards after it are empty)
+	bool below(const Key &key, size_type i) const {
+		const Key *p = _splits[i].load(std::memory_order_acquire);
+		return !p || _comp(key,*p);
+	}
+
+	size_type locate(const Key &key) const {
+		if (_partition==by_hash)
+			return hashof(key,is_hashable<Key>()) % _shards.size();
+		// first split point above key
+		size_type lo = 0, hi = _splits.size();
+		while(lo<hi) {
+			size_type mid = lo+(hi-lo)/2;
+			if (below(key,mid)) hi = mid;
+			else lo = mid+1;
+		}
+		return lo;
+	}
+
+	static std::size_t hashof(const Key &key, std::true_type) {
+		return mixhash(std::hash<Key>()(key));
+	}
+	static std::size_t hashof(const Key &, std::false_type) { return 0; }
+
+	// locks and returns the shard holding key.  The split points read
+	// by locate may be moving; the bounds rechecked under the shard's
+	// lock are not
+	shard &lockshard(const Key &key, std::unique_lock<std::mutex> &l) const {
+		for(;;) {
+			size_type i = locate(key);
+			shard &s = *_shards[i];
+			l = std::unique_lock<std::mutex>(s.m);
+			if (_partition==by_hash) return s;
+			if ((i==0 || !below(key,i-1))
+					&& (i==_splits.size() || below(key,i)))
+				return s;
+			l.unlock();
+		}
+	}
+
+	// in shard order (the order rebalancing locks neighbours in)
+	void lockall(std::vector<std::unique_lock<std::mutex>> &locks) const {
+		for(auto &s : _shards) locks.emplace_back(s->m);
+	}
+
+	template<typename V>
+	bool insert_impl(V &&value) {
+		bool added;
+		size_type n;
+		{
+			std::unique_lock<std::mutex> l;
+			shard &s = lockshard(value,l);
+			added = s.s.insert(std::forward<V>(value)).second;
+			n = s.s.size();
+			s.n.store(n,std::memory_order_relaxed);
+		}
+		if (added && overfull(n)) {
+			// (if another writer is rebalancing already, leave it to that)
+			std::unique_lock<std::mutex> l(_rebalancing,std::try_to_lock);
+			if (l.owns_lock()) rebalance_locked(false);
+		}
+		return added;
+	}
+
+	// (compares with the smallest shard at the last rebalance, so it
+	// reads no other shard's counter)
+	bool overfull(size_type n) const {
+		if (_partition==by_hash || _shards.size()<2) return false;
+		double threshold = _threshold.load(std::memory_order_relaxed);
+		if (threshold<=1.0 || n<_minsize.load(std::memory_order_relaxed))
+			return false;
+		return n > threshold*_floor.load(std::memory_order_relaxed);
+	}
+
+	// requires _rebalancing held.  Unless forced, first checks that the
+	// shards really are out of balance (otherwise just notes the current
+	// smallest size)
+	void rebalance_locked(bool force) {
+		size_type nshards = _shards.size();
+		if (_partition==by_hash || nshards<2) return;
+		size_type total = 0, smallest = size_type(-1), largest = 0;
+		for(auto &s : _shards) {
+			size_type n = s->n.load(std::memory_order_relaxed);
+			total += n;
+			smallest = std::min(smallest,n);
+			largest = std::max(largest,n);
+		}
+		if (total>0 && (force || largest > _threshold.load(
+				std::memory_order_relaxed)*std::max<size_type>(smallest,1))) {
+			// boundary i: shards 0..i should hold (i+1)/nshards of the keys
+			size_type before = 0; // keys in the shards left of boundary i
+			for(size_type i=0;i+1<nshards;i++) {
+				shard &a = *_shards[i], &b = *_shards[i+1];
+				std::lock_guard<std::mutex> la(a.m);
+				std::lock_guard<std::mutex> lb(b.m);
+				size_type want = (i+1)*total/nshards;
+				size_type have = before+a.s.size();
+				if (have>want)
+					moveright(i,std::min(have-want,a.s.size()));
+				else if (have<want && b.s.size()>1)
+					moveleft(i,std::min(want-have,b.s.size()-1));
+				a.n.store(a.s.size(),std::memory_order_relaxed);
+				b.n.store(b.s.size(),std::memory_order_relaxed);
+				before += a.s.size();
+			}
+			smallest = size_type(-1);
+			for(auto &s : _shards)
+				smallest = std::min(smallest,
+					static_cast<size_type>(s->n.load(std::memory_order_relaxed)));
+		}
+		_floor.store(std::max<size_type>(smallest,1),std::memory_order_relaxed);
+	}
+
+	// the last m keys of shard i become the first of shard i+1 (both
+	// locked).  Shard keys are const, so they are copied
+	void moveright(size_type i, size_type m) {
+		if (m==0) return;
+		shard_type &a = _shards[i]->s, &b = _shards[i+1]->s;
+		shard_type nb(_comp,b.get_allocator());
+		nb.set_growth(b.growth_factor());
+		nb.reserve(m+b.size());
+		auto first = a.end()-m;
+		for(auto j=first;j!=a.end();++j) nb.insert(nb.end(),*j);
+		for(auto &x : b) nb.insert(nb.end(),x);
+		a.erase(first,a.end());
+		b.swap(nb);
+		setsplit(i,*b.begin());
+	}
+
+	// the first m keys of shard i+1 become the last of shard i (m is
+	// less than shard i+1's size, so it keeps a first key for the split)
+	void moveleft(size_type i, size_type m) {
+		if (m==0) return;
+		shard_type &a = _shards[i]->s, &b = _shards[i+1]->s;
+		auto last = b.begin()+m;
+		a.reserve(a.size()+m);
+		for(auto j=b.begin();j!=last;++j) a.insert(a.end(),*j);
+		b.erase(b.begin(),last);
+		setsplit(i,*b.begin());
+	}
+
+	// requires _rebalancing (or construction) and the locks of shards i
+	// and i+1
+	template<typename K>
+	void setsplit(size_type i, K &&key) {
+		_splitkeys.emplace_back(new Key(std::forward<K>(key)));
+		_splits[i].store(_splitkeys.back().get(),std::memory_order_release);
+	}
+
+	// by hash: k-way merge of the shards, all locked throughout
+	template<typename F>
+	F merge_each(F &f) const {
+		std::vector<std::unique_lock<std::mutex>> locks;
+		lockall(locks);
+		using run = std::pair<typename shard_type::const_iterator,
+				typename shard_type::const_iterator>;
+		std::vector<run> heap;
+		for(auto &s : _shards)
+			if (!s->s.empty()) heap.emplace_back(s->s.begin(),s->s.end());
+		auto later = [this](const run &x, const run &y) {
+			return _comp(*y.first,*x.first);
+		};
+		std::make_heap(heap.begin(),heap.end(),later);
+		while(!heap.empty()) {
+			std::pop_heap(heap.begin(),heap.end(),later);
+			run &r = heap.back();
+			f(*r.first);
+			if (++r.first==r.second) heap.pop_back();
+			else std::push_heap(heap.begin(),heap.end(),later);
+		}
+		return f;
+	}
+
+	Compare _comp;
+	partition _partition;
+	std::vector<std::unique_ptr<shard>> _shards;
+	std::vector<std::atomic<const Key *>> _splits; // null: none yet
+	std::atomic<double> _threshold{2.0};
+	std::atomic<size_type> _minsize{4096};
+	std::atomic<size_type> _floor{0}; // smallest shard, last rebalance
+	mutable std::mutex _rebalancing;
+	std::vector<std::unique_ptr<Key>> _splitkeys; // current and replaced
+
+};
+
+template<typename Key, typename Compare, typename Allocator>
+constexpr std::size_t
+	sharded_vset_ordered<Key,Compare,Allocator>::cacheline;
+
+}
+
+#endif
@@ -1,23 +1,47 @@
 #include "vset.h"
+#include "vset_ordered.h"
 #include <set>
 #include <iostream>
 
 using namespace sortedvector;
 using namespace std;
 
+// v and o must equal (and hash as) sets freshly built from s, whatever
+// order v holds its keys in
+void checkhash(const vset<int> &v, const vset_ordered<int> &o,
+		const set<int> &s) {
+	vset<int> w;
+	for(auto &x : s) w.insert(x);
+	vset_ordered<int> fresh(s.begin(),s.end());
+	cout << "equal: " << (v==w) << ' ' << (o==fresh)
+		<< " hash: " << (v.content_hash()==w.content_hash())
+		<< ' ' << (o.content_hash()==fresh.content_hash())
+		<< ' ' << (v.content_hash()==o.content_hash()) << endl;
+}
+
+// a moved-from or swapped-out set must equal (and hash as) an empty set
+void checkempty(const vset<int> &v, const vset_ordered<int> &o) {
+	cout << "empty: " << (v==vset<int>()) << ' ' << (o==vset_ordered<int>())
+		<< " hash: " << (v.content_hash()==vset<int>().content_hash())
+		<< ' ' << (o.content_hash()==vset_ordered<int>().content_hash())
+		<< endl;
+}
+
 int main(int argc, char **argv) {
 	vset<int> v;
+	vset_ordered<int> o;
 	set<int> s;
 
 	while(true) {
 		char c;
-		cin >> c;
+		if (!(cin >> c)) break;
 		cout << "command = " << c << endl;
 		switch(c) {
 			case 'i': {
 				int i;
 				cin >> i;
 				v.insert(i);
+				o.insert(i);
 				s.insert(i);
 				break;
 			}
@@ -25,11 +49,13 @@ int main(int argc, char **argv) {
 				int i;
 				cin >> i;
 				v.emplace(i);
+				o.emplace(i);
 				s.emplace(i);
 				break;
 			}
 			case 'c': {
 				v.clear();
+				o.clear();
 				s.clear();
 				break;
 			}
@@ -37,9 +63,34 @@ int main(int argc, char **argv) {
 				int i;
 				cin >> i;
 				v.erase(i);
+				o.erase(i);
 				s.erase(i);
 				break;
 			}
+			case 'h': {
+				checkhash(v,o,s);
+				break;
+			}
+			case 'm': {
+				vset<int> v2(std::move(v));
+				vset_ordered<int> o2(std::move(o));
+				checkempty(v,o);
+				v = std::move(v2);
+				o = std::move(o2);
+				checkempty(v2,o2);
+				break;
+			}
+			case 'w': {
+				vset<int> v2;
+				vset_ordered<int> o2;
+				v.swap(v2);
+				o.swap(o2);
+				checkempty(v,o);
+				v.swap(v2);
+				o.swap(o2);
+				checkempty(v2,o2);
+				break;
+			}
 			case 's': {
 				cout << v.size() << ' ' << s.size() << endl;
 				break;
@@ -76,6 +127,9 @@ int main(int argc, char **argv) {
 		cout << "vset:";
 		for(auto &x : v) cout << ' ' << x;
 		cout << endl;
+		cout << "vset_ordered:";
+		for(auto &x : o) cout << ' ' << x;
+		cout << endl;
 		cout << " set:";
 		for(auto &x : s) cout << ' ' << x;
 		cout << endl;
@@ -1,10 +1,23 @@
 #include <set>
 #include "vset.h"
 #include "vset_ordered.h"
+#include "vset_rebuild.h"
+#include "vm_allocator.h"
+#include "sharded_vset_ordered.h"
+#include "vset_columns.h"
 #include <vector>
 #include <utility>
 #include <chrono>
 #include <iostream>
+#include <random>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <tuple>
+#include <climits>
 
 using namespace std;
 using namespace std::chrono;
@@ -67,7 +80,214 @@ vector<pair<int,double>> timelookup(int x0, int dx, int x1,
 	return ret;
 }
 
+// prints p50/p99/max of a list of latencies (in microseconds)
+void reportlatency(const char *name, vector<double> &lat) {
+	if (lat.empty()) return;
+	sort(lat.begin(),lat.end());
+	cout << name << ": " << lat.size() << " ticks, p50 = "
+		<< lat[lat.size()/2] << "us, p99 = "
+		<< lat[lat.size()*99/100] << "us, max = "
+		<< lat.back() << "us" << endl;
+}
+
+// foreground latency while a set of n keys is replaced by n new ones:
+// once with the blocking range constructor, once with a vset_rebuild
+// stepped in slices between lookups (as an event loop would), and once
+// with a vset_rebuild finishing on a background thread
+template<typename K, typename G>
+void timerebuild(int n, int sliceus, G generator) {
+	using S = vset_ordered<K>;
+	vector<K> keys;
+	for(int i=0;i<n;i++) keys.push_back(generator());
+
+	auto t0 = high_resolution_clock::now();
+	S b(keys.begin(),keys.end(),std::less<K>());
+	auto t1 = high_resolution_clock::now();
+	cout << "blocking resort: " << duration_cast<microseconds>(t1-t0).count()
+		<< "us in one call" << endl;
+
+	for(int async=0;async<2;async++) {
+		S s(b);
+		vector<K> newkeys;
+		for(int i=0;i<n;i++) newkeys.push_back(generator());
+		vset_rebuild<K> rb(s,std::move(newkeys));
+		if (async) rb.run_async();
+		vector<double> lat;
+		bool done = false;
+		while(!done) {
+			auto t0 = high_resolution_clock::now();
+			s.find(generator());
+			done = async ? rb.done() : rb.step_for(microseconds(sliceus));
+			auto t1 = high_resolution_clock::now();
+			lat.push_back(duration_cast<nanoseconds>(t1-t0).count()/1000.0);
+		}
+		auto t2 = high_resolution_clock::now();
+		vector<K> old = rb.commit();
+		auto t3 = high_resolution_clock::now();
+		reportlatency(async ? "background rebuild" : "stepped rebuild",lat);
+		cout << "  commit: " << duration_cast<microseconds>(t3-t2).count()
+			<< "us (old contents handed back, " << old.size() << " keys)"
+			<< endl;
+	}
+}
+
+// timeit rebuild [n=10000000] [slice_us=200] [int|string]
+int rebuildmain(int argc, char **argv) {
+	int n = argc>1 ? atoi(argv[1]) : 10000000;
+	int sliceus = argc>2 ? atoi(argv[2]) : 200;
+	bool strings = argc>3 && string(argv[3])=="string";
+
+	std::default_random_engine rand(std::random_device{}());
+	std::uniform_int_distribution<int> uniform(0,n*2);
+	if (strings)
+		timerebuild<string>(n,sliceus,[&rand,&uniform]() {
+			return "key" + std::to_string(uniform(rand)); });
+	else
+		timerebuild<int>(n,sliceus,[&rand,&uniform]() {
+			return uniform(rand); });
+	return 0;
+}
+
+// appends n increasing keys at the end (the timestamp-ingest pattern)
+// and reports total time and the worst single insert
+template<typename S>
+void timeappend(const char *name, S &s, long n) {
+	double worst = 0;
+	auto start = high_resolution_clock::now();
+	for(long i=0;i<n;i++) {
+		auto t0 = high_resolution_clock::now();
+		s.insert(s.end(),i);
+		auto t1 = high_resolution_clock::now();
+		worst = max(worst,duration_cast<nanoseconds>(t1-t0).count()/1000.0);
+	}
+	auto stop = high_resolution_clock::now();
+	cout << name << ": " << duration_cast<milliseconds>(stop-start).count()
+		<< "ms total, worst insert = " << worst << "us, slack = "
+		<< s.slack_bytes() << " bytes" << endl;
+}
+
+// timeit growth [n=16000000]
+int growthmain(int argc, char **argv) {
+	long n = argc>1 ? atol(argv[1]) : 16000000;
+	{
+		vset_ordered<long> s;
+		timeappend("default growth",s,n);
+	}
+	{
+		vset_ordered<long,less<long>,vm_allocator<long>> s;
+		s.reserve(n);
+		timeappend("vm_allocator, reserved",s,n);
+	}
+	{
+		vset_ordered<long,less<long>,vm_allocator<long>>
+			s(less<long>(),vm_allocator<long>(true));
+		s.reserve(n);
+		timeappend("vm_allocator (huge pages), reserved",s,n);
+	}
+	return 0;
+}
+
+// runs nthreads writers, each inserting n random keys through insert,
+// and returns the insert rate in millions per second
+template<typename F>
+double timewriters(int nthreads, int n, F insert) {
+	vector<thread> threads;
+	auto t0 = high_resolution_clock::now();
+	for(int t=0;t<nthreads;t++)
+		threads.emplace_back([t,n,&insert]() {
+			std::default_random_engine rand(t);
+			std::uniform_int_distribution<int> uniform;
+			for(int i=0;i<n;i++) insert(uniform(rand));
+		});
+	for(auto &th : threads) th.join();
+	auto t1 = high_resolution_clock::now();
+	return (double)nthreads*n/duration_cast<microseconds>(t1-t0).count();
+}
+
+// timeit sharded [n per thread=200000] [max threads=cores] [shards=32]
+// insert throughput of one locked vset_ordered and of a
+// sharded_vset_ordered (by range and by hash), for 1, 2, 4, ... writer
+// threads
+int shardedmain(int argc, char **argv) {
+	int n = argc>1 ? atoi(argv[1]) : 200000;
+	int maxthreads = argc>2 ? atoi(argv[2])
+				: max(1,(int)thread::hardware_concurrency());
+	int nshards = argc>3 ? atoi(argv[3]) : 32;
+	using sharded_type = sharded_vset_ordered<int>;
+	for(int t=1;t<=maxthreads;t*=2) {
+		vset_ordered<int> single;
+		mutex m;
+		double r1 = timewriters(t,n,[&](int k) {
+			lock_guard<mutex> l(m);
+			single.insert(k);
+		});
+		sharded_type byrange(nshards);
+		double r2 = timewriters(t,n,[&](int k) { byrange.insert(k); });
+		sharded_type byhash(nshards,sharded_type::by_hash);
+		double r3 = timewriters(t,n,[&](int k) { byhash.insert(k); });
+		cout << t << " threads: locked vset_ordered " << r1
+			<< " Mops/s, sharded by range " << r2 << " Mops/s ("
+			<< byrange.split_points().size() << " split points), by hash "
+			<< r3 << " Mops/s" << endl;
+	}
+	return 0;
+}
+
+// timeit prefix [n=2000000] [leading values=1000] [queries=1000000]
+// all-keys-for-one-leading-value queries on (int,long,long) keys, stored
+// as vset_ordered<tuple> and as vset_columns
+int prefixmain(int argc, char **argv) {
+	using K = tuple<int,long,long>;
+	int n = argc>1 ? atoi(argv[1]) : 2000000;
+	int nlead = argc>2 ? atoi(argv[2]) : 1000;
+	int nq = argc>3 ? atoi(argv[3]) : 1000000;
+
+	std::default_random_engine rand(1);
+	std::uniform_int_distribution<int> lead(0,nlead-1);
+	std::uniform_int_distribution<long> rest(0,LONG_MAX);
+	vector<K> keys;
+	for(int i=0;i<n;i++) keys.emplace_back(lead(rand),rest(rand),rest(rand));
+	vset_ordered<K> tuples(keys.begin(),keys.end(),less<K>());
+	sort(keys.begin(),keys.end());
+	vset_columns<K> columns;
+	columns.reserve(keys.size());
+	for(auto &k : keys) columns.insert(k);
+
+	vector<int> q;
+	for(int i=0;i<nq;i++) q.push_back(lead(rand));
+	long found = 0;
+	auto t0 = high_resolution_clock::now();
+	for(int t : q)
+		found += tuples.lower_bound(K(t+1,LONG_MIN,LONG_MIN))
+			- tuples.lower_bound(K(t,LONG_MIN,LONG_MIN));
+	auto t1 = high_resolution_clock::now();
+	for(int t : q) {
+		auto r = columns.equal_range(t);
+		found -= r.second-r.first;
+	}
+	auto t2 = high_resolution_clock::now();
+	if (found!=0) cout << "mismatch!" << endl;
+	cout << "vset_ordered<tuple>: "
+		<< duration_cast<milliseconds>(t1-t0).count() << "ms, "
+		<< tuples.size()*sizeof(K) << " bytes" << endl;
+	cout << "vset_columns: "
+		<< duration_cast<milliseconds>(t2-t1).count() << "ms, "
+		<< columns.bytes() << " bytes" << endl;
+	return 0;
+}
+
+// timeit [x0 dx x1 n]: insert/lookup times for set sizes x0..x1
+// timeit <mode> ...: see the *main functions above
 int main(int argc, char **argv) {
+	if (argc>1 && string(argv[1])=="rebuild")
+		return rebuildmain(argc-1,argv+1);
+	if (argc>1 && string(argv[1])=="growth")
+		return growthmain(argc-1,argv+1);
+	if (argc>1 && string(argv[1])=="sharded")
+		return shardedmain(argc-1,argv+1);
+	if (argc>1 && string(argv[1])=="prefix")
+		return prefixmain(argc-1,argv+1);
+
 	int x0 = argc>1 ? atoi(argv[1]) : 10;
 	int dx = argc>2 ? atoi(argv[2]) : 10;
 	int x1 = argc>3 ? atoi(argv[3]) : 1000;
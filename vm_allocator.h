@@ -0,0 +1,82 @@
+#ifndef VM_ALLOCATOR_H
+#define VM_ALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace sortedvector {
+
+// Allocator that maps each allocation directly from the OS (POSIX mmap)
+// without reserving swap for it, so memory is only backed by pages
+// once they are written.  Reserving a large capacity is then nearly
+// free, which lets a vset_ordered be given its maximum size up front
+// and grow into it without ever reallocating:
+//
+//	vset_ordered<long,std::less<long>,vm_allocator<long>> s;
+//	s.reserve(1ul<<32); // address space only
+//
+// With hugepages set, allocations are rounded to 2MB and advised for
+// transparent huge pages (where the system supports it), cutting TLB
+// misses on large sets.
+//
+// Every allocation is at least a page, so this is meant for the one
+// large array behind a set, not for many small containers.
+
+template<typename T>
+class vm_allocator {
+public:
+	using value_type = T;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+
+	template<typename U>
+	struct rebind { using other = vm_allocator<U>; };
+
+	explicit vm_allocator(bool hugepages = false) : _huge(hugepages) {}
+
+	template<typename U>
+	vm_allocator(const vm_allocator<U> &a) : _huge(a.hugepages()) {}
+
+	bool hugepages() const { return _huge; }
+
+	T *allocate(size_type n) {
+		if (n>static_cast<size_type>(-1)/sizeof(T)) throw std::bad_alloc();
+		size_type bytes = round(n*sizeof(T));
+		void *p = mmap(nullptr,bytes,PROT_READ|PROT_WRITE,
+				MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE,-1,0);
+		if (p==MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+		if (_huge) madvise(p,bytes,MADV_HUGEPAGE);
+#endif
+		return static_cast<T *>(p);
+	}
+
+	void deallocate(T *p, size_type n) {
+		munmap(p,round(n*sizeof(T)));
+	}
+
+	template<typename U>
+	bool operator==(const vm_allocator<U> &a) const {
+		return _huge==a.hugepages();
+	}
+	template<typename U>
+	bool operator!=(const vm_allocator<U> &a) const {
+		return !(*this==a);
+	}
+
+private:
+	size_type round(size_type bytes) const {
+		size_type unit = _huge ? size_type(2)<<20
+					: static_cast<size_type>(sysconf(_SC_PAGESIZE));
+		if (bytes==0) bytes = 1;
+		return (bytes+unit-1)/unit*unit;
+	}
+
+	bool _huge;
+};
+
+}
+
+#endif
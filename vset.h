@@ -6,6 +6,8 @@
 #include <vector>
 #include <utility>
 #include <algorithm>
+#include <cstddef>
+#include "vset_hash.h"
 
 namespace sortedvector {
 
@@ -25,9 +27,10 @@ public:
 	using const_reference = const value_type &;
 	using pointer = typename std::allocator_traits<Allocator>::pointer;
 	using const_pointer = typename std::allocator_traits<Allocator>::const_pointer;
-	using iterator = typename base_type::iterator;
+	// (as with std::set, keys cannot be changed through an iterator)
+	using iterator = typename base_type::const_iterator;
 	using const_iterator = typename base_type::const_iterator;
-	using reverse_iterator = typename base_type::reverse_iterator;
+	using reverse_iterator = typename base_type::const_reverse_iterator;
 	using const_reverse_iterator = typename base_type::const_reverse_iterator;
 
 	using mytype = vset<Key,Compare,Allocator>;
@@ -46,29 +49,36 @@ public:
 	vset(InputIt first, InputIt last, const Compare &comp = Compare(),
 						const Allocator &alloc = Allocator() )
 			: _comp(comp), _v(first,last,alloc) {
+		_fp.assign(_v.begin(),_v.end());
 	}
 
 	template<class InputIt>
 	vset(InputIt first, InputIt last, const Allocator &alloc = Allocator() )
 			: _comp(Compare()), _v(first,last,alloc) {
+		_fp.assign(_v.begin(),_v.end());
 	}
 
 	vset(const vset &s) = default;
 	vset(const vset &s, const Allocator &alloc)
-			: _comp(s._comp), _v(s._v,alloc) {}
+			: _comp(s._comp), _v(s._v,alloc), _fp(s._fp) {}
 
 	vset(vset &&s) = default;
 	vset(vset &&s, const Allocator &alloc)
-		: _comp(std::move(s._comp)), _v(std::move(s._v),alloc) {}
+		: _comp(std::move(s._comp)), _v(std::move(s._v),alloc),
+		  _fp(std::move(s._fp)) {}
 
 	vset(std::initializer_list<value_type> init,
 			const Compare &comp = Compare(),
 			const Allocator &alloc = Allocator())
-				: _comp(comp), _v(init,alloc) {}
+				: _comp(comp), _v(init,alloc) {
+		_fp.assign(_v.begin(),_v.end());
+	}
 	// for C++14, need following
 	vset(std::initializer_list<value_type> init,
 			const Allocator &alloc = Allocator())
-				: _comp(Compare()), _v(init,alloc) {}
+				: _comp(Compare()), _v(init,alloc) {
+		_fp.assign(_v.begin(),_v.end());
+	}
 
 	// destructor:
 	~vset() = default;
@@ -78,6 +88,8 @@ public:
 	mytype &operator=(mytype &&) = default;
 	mytype &operator=(std::initializer_list<value_type> ilist) {
 		_v = ilist;
+		_fp.assign(_v.begin(),_v.end());
+		return *this;
 	}
 
 	// other functions:
@@ -86,6 +98,7 @@ public:
 	void swap(vset &s) {
 		std::swap(_comp,s._comp);
 		_v.swap(s._v);
+		std::swap(_fp,s._fp);
 	}
 
 	size_type count(const Key &key) const {
@@ -98,61 +111,76 @@ public:
 	value_compare value_comp() const { return _comp; }
 
 	// comparisons:
-	
-	// below don't work unless presorted... TODO
+	//
+	// The keys are stored in insertion order, so these compare sorted
+	// copies (O(n log n)); the result is as if both were vset_ordered.
+	// Equality first rejects on size and, for hashable keys, on the
+	// content fingerprint -- both O(1).
+
 	bool operator==(const mytype &rhs) const {
-		return _v==rhs._v;
+		if (_v.size()!=rhs._v.size() || _fp!=rhs._fp) return false;
+		return sorted()==rhs.sorted();
 	}
 	bool operator!=(const mytype &rhs) const {
-		return _v!=rhs._v;
+		return !(*this==rhs);
 	}
 	bool operator<(const mytype &rhs) const {
-		return _v<rhs._v;
+		return sorted()<rhs.sorted();
 	}
 	bool operator<=(const mytype &rhs) const {
-		return _v<=rhs._v;
+		return !(rhs<*this);
 	}
 	bool operator>(const mytype &rhs) const {
-		return _v>rhs._v;
+		return rhs<*this;
 	}
 	bool operator>=(const mytype &rhs) const {
-		return _v>=rhs._v;
+		return !(*this<rhs);
+	}
+
+	// order-independent hash of the contents (see vset_hash.h), kept up
+	// to date by insert and erase; O(1)
+	std::size_t content_hash() const {
+		static_assert(content_fingerprint<Key>::enabled,
+				"content_hash requires std::hash<Key>");
+		return _fp.value();
 	}
 
 	// for C++14 need to add templated count (only for compares that
 	//  for which Compare::is_transparent is valid) -- not quite sure how
 
 	// removal:
-	void clear() { _v.clear(); }
+	void clear() { _fp.clear(); _v.clear(); }
 
 	iterator erase(const_iterator pos) {
+		_fp.remove(*pos);
 		return _v.erase(pos);
 	}
 
 	//iterator erase(const_iterator first, const_iterator last) {
 	iterator erase(iterator first, iterator last) {
+		for(const_iterator i=first;i!=last;++i) _fp.remove(*i);
 		return _v.erase(first,last);
 	}
 
 	size_type erase(const key_type &key) {
-		std::pair<iterator,iterator> r
-			= std::equal_range(_v.begin(),_v.end(),key,_comp);
-		erase(r.first,r.second);
-		return r.second-r.first;
+		const_iterator loc = find(key);
+		if (loc==_v.end()) return 0;
+		erase(loc);
+		return 1;
 	}
 
 	// iterators:
 	iterator begin() { return _v.begin(); }
 	const_iterator begin() const { return _v.begin(); }
 	const_iterator vbegin() const { return _v.cbegin(); }
-	iterator rbegin() { return _v.rbegin(); }
-	const_iterator rbegin() const { return _v.rbegin(); }
+	reverse_iterator rbegin() { return _v.crbegin(); }
+	const_reverse_iterator rbegin() const { return _v.crbegin(); }
 
 	iterator end() { return _v.end(); }
 	const_iterator end() const { return _v.end(); }
 	const_iterator vend() const { return _v.cend(); }
-	iterator rend() { return _v.rend(); }
-	const_iterator rend() const { return _v.rend(); }
+	reverse_iterator rend() { return _v.crend(); }
+	const_reverse_iterator rend() const { return _v.crend(); }
 
 	// size functions:
 
@@ -211,26 +239,30 @@ public:
 
 	std::pair<iterator,bool> insert(const value_type &value) {
 		auto loc = find(value);
-		if (loc!=end()) return {loc,false};
-		else return {_v.insert(_v.end(),value),true};
+		if (loc!=_v.end()) return {loc,false};
+		_fp.add(value);
+		return {_v.insert(_v.end(),value),true};
 	}
 
 	std::pair<iterator,bool> insert(value_type &&value) {
 		auto loc = find(value);
-		if (loc!=end()) return {loc,false};
-		else return {_v.insert(_v.end(),std::move(value)),true};
+		if (loc!=_v.end()) return {loc,false};
+		_fp.add(value);
+		return {_v.insert(_v.end(),std::move(value)),true};
 	}
 
 	iterator insert(const_iterator hint, const value_type &value) {
 		auto loc = find(value);
-		if (loc!=end()) return loc;
-		else return _v.insert(_v.end(),value);
+		if (loc!=_v.end()) return loc;
+		_fp.add(value);
+		return _v.insert(_v.end(),value);
 	}
 	
 	iterator insert(const_iterator hint, value_type &&value) {
 		auto loc = find(value);
-		if (loc!=end()) return loc;
-		else return _v.insert(_v.end(),std::move(value));
+		if (loc!=_v.end()) return loc;
+		_fp.add(value);
+		return _v.insert(_v.end(),std::move(value));
 	}
 
 	template<typename inputit>
@@ -248,10 +280,12 @@ public:
 		iterator loc = std::find_if(_v.begin(),_v.end()-1,
 			[this](const Key &k1) {
 				return !_comp(k1,_v.back()) && !_comp(_v.back(),k1); });
-		if (loc==_v.end()-1) {
+		if (loc!=_v.end()-1) { // already present
 			_v.pop_back();
 			return {loc,false};
-		} else return {loc,true};
+		}
+		_fp.add(*loc);
+		return {loc,true};
 	}
 
 	template<typename... Args>
@@ -261,13 +295,28 @@ public:
 		
 protected:
 
+	base_type sorted() const {
+		base_type ret(_v);
+		std::sort(ret.begin(),ret.end(),_comp);
+		return ret;
+	}
+
 	Compare _comp;
 	base_type _v;
+	content_fingerprint<Key> _fp;
 
 };
 
 
 
+}
+
+namespace std {
+	template<typename Key, typename Compare, typename Allocator>
+	struct hash<sortedvector::vset<Key,Compare,Allocator>>
+		: sortedvector::content_hasher<
+			sortedvector::vset<Key,Compare,Allocator>> {
+	};
 }
 
 #endif
@@ -0,0 +1,355 @@
+#ifndef VSET_COLUMNS_H
+#define VSET_COLUMNS_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+
+namespace sortedvector {
+
+// Column storage used by vset_columns.  Both kinds hold one component
+// of every key, in key order, and search only within a position range
+// [lo,hi) over which all earlier components are equal (so the values
+// there are sorted).
+
+// plain column: one value per key
+template<typename T>
+class plain_column {
+public:
+	using value_type = T;
+	using size_type = typename std::vector<T>::size_type;
+
+	size_type size() const { return _v.size(); }
+	const T &get(size_type i) const { return _v[i]; }
+
+	void insert(size_type i, const T &x) { _v.insert(_v.begin()+i,x); }
+	void erase(size_type i) { _v.erase(_v.begin()+i); }
+	void clear() { _v.clear(); }
+	void reserve(size_type n) { _v.reserve(n); }
+
+	size_type lower_bound(size_type lo, size_type hi, const T &x) const {
+		return std::lower_bound(_v.begin()+lo,_v.begin()+hi,x)-_v.begin();
+	}
+	size_type upper_bound(size_type lo, size_type hi, const T &x) const {
+		return std::upper_bound(_v.begin()+lo,_v.begin()+hi,x)-_v.begin();
+	}
+
+	size_type bytes() const { return _v.capacity()*sizeof(T); }
+
+private:
+	std::vector<T> _v;
+};
+
+// run-length encoded column: one value per run of equal adjacent
+// components.  Run r covers positions [end[r-1],end[r]).  Searches are
+// over runs, not positions, so a leading column with few distinct
+// values (a tenant id, say) costs a search over those values only.
+template<typename T>
+class rle_column {
+public:
+	using value_type = T;
+	using size_type = typename std::vector<T>::size_type;
+
+	size_type size() const { return _end.empty() ? 0 : _end.back(); }
+	size_type runs() const { return _val.size(); }
+	const T &get(size_type i) const { return _val[run(i)]; }
+
+	void insert(size_type i, const T &x) {
+		size_type r = run(i); // run holding i (runs() if i==size())
+		if (r<runs() && start(r)<i) {
+			// inside a run
+			if (!(_val[r]<x) && !(x<_val[r])) {
+				bump(r,1);
+				return;
+			}
+			// split it: [start,i) x [i,end).  Never needed for the first
+			// column, which is sorted overall.  A later column is only
+			// sorted within each prefix of earlier columns, so one run can
+			// span several prefixes: in (1,5),(2,5) the second column is
+			// one run of 5, and inserting (1,7) lands inside it.
+			_val.insert(_val.begin()+r+1,2,x);
+			_val[r+2] = _val[r];
+			_end.insert(_end.begin()+r,2,i);
+			bump(r+1,1);
+			return;
+		}
+		// at the boundary between run r-1 and run r
+		if (r>0 && !(_val[r-1]<x) && !(x<_val[r-1])) bump(r-1,1);
+		else if (r<runs() && !(_val[r]<x) && !(x<_val[r])) bump(r,1);
+		else {
+			_val.insert(_val.begin()+r,x);
+			_end.insert(_end.begin()+r,i);
+			bump(r,1);
+		}
+	}
+
+	void erase(size_type i) {
+		size_type r = run(i);
+		bump(r,-1);
+		if (start(r)==_end[r]) {
+			_val.erase(_val.begin()+r);
+			_end.erase(_end.begin()+r);
+			// neighbours may now be equal: merge them
+			if (r>0 && r<runs()
+					&& !(_val[r-1]<_val[r]) && !(_val[r]<_val[r-1])) {
+				_val.erase(_val.begin()+r-1);
+				_end.erase(_end.begin()+r-1);
+			}
+		}
+	}
+
+	void clear() { _val.clear(); _end.clear(); }
+	void reserve(size_type) { }
+
+	size_type lower_bound(size_type lo, size_type hi, const T &x) const {
+		if (lo>=hi) return lo;
+		size_type r0 = run(lo), r1 = run(hi-1)+1;
+		size_type r = std::lower_bound(_val.begin()+r0,_val.begin()+r1,x)
+				-_val.begin();
+		return r==r1 ? hi : std::max(lo,start(r));
+	}
+	size_type upper_bound(size_type lo, size_type hi, const T &x) const {
+		if (lo>=hi) return lo;
+		size_type r0 = run(lo), r1 = run(hi-1)+1;
+		size_type r = std::upper_bound(_val.begin()+r0,_val.begin()+r1,x)
+				-_val.begin();
+		return r==r1 ? hi : std::max(lo,start(r));
+	}
+
+	size_type bytes() const {
+		return _val.capacity()*sizeof(T)+_end.capacity()*sizeof(size_type);
+	}
+
+private:
+	size_type run(size_type i) const {
+		return std::upper_bound(_end.begin(),_end.end(),i)-_end.begin();
+	}
+	size_type start(size_type r) const { return r ? _end[r-1] : 0; }
+	void bump(size_type r, int d) {
+		for(;r<_end.size();++r) _end[r] += d;
+	}
+
+	std::vector<T> _val;
+	std::vector<size_type> _end;
+};
+
+// A sorted set of composite keys (a std::tuple, compared
+// lexicographically with operator< on each component) stored column
+// by column rather than as an array of tuples.
+//
+// A lookup narrows a position range one column at a time, so each
+// binary search step reads a single component and prefix queries
+// (equal_range on the first few components) never touch the later
+// columns.  The first RLE columns are run-length encoded (see
+// rle_column); the rest are plain vectors.
+//
+// Keys are identified by position: find returns size() when the key is
+// absent, and equal_range returns a [first,last) pair of positions.
+
+template<typename Tuple, std::size_t RLE = 1>
+class vset_columns;
+
+template<typename... Ts, std::size_t RLE>
+class vset_columns<std::tuple<Ts...>,RLE> {
+public:
+	using key_type = std::tuple<Ts...>;
+	using value_type = key_type;
+	using size_type = std::size_t;
+
+	static constexpr std::size_t ncolumns = sizeof...(Ts);
+
+	template<std::size_t C>
+	using column_type = typename std::conditional<(C<RLE),
+			rle_column<typename std::tuple_element<C,key_type>::type>,
+			plain_column<typename std::tuple_element<C,key_type>::type>
+		>::type;
+
+	using mytype = vset_columns<key_type,RLE>;
+
+	// constructors:
+	vset_columns() = default;
+
+	template<class InputIt>
+	vset_columns(InputIt first, InputIt last) { insert(first,last); }
+
+	vset_columns(std::initializer_list<value_type> init) {
+		insert(init);
+	}
+
+	// size functions:
+
+	bool empty() const { return size()==0; }
+	size_type size() const { return std::get<0>(_cols).size(); }
+
+	void reserve(size_type n) { reserve_all(n,indices()); }
+
+	// bytes held by the columns (including slack capacity)
+	size_type bytes() const { return bytes_all(indices()); }
+
+	template<std::size_t C>
+	const column_type<C> &column() const { return std::get<C>(_cols); }
+
+	// element access:
+
+	key_type operator[](size_type i) const { return get_all(i,indices()); }
+
+	template<std::size_t C>
+	const typename std::tuple_element<C,key_type>::type &
+	get(size_type i) const {
+		return std::get<C>(_cols).get(i);
+	}
+
+	// find:
+
+	size_type find(const key_type &key) const {
+		std::pair<size_type,size_type> r = equal_range(key);
+		return r.first==r.second ? size() : r.first;
+	}
+
+	size_type count(const key_type &key) const {
+		std::pair<size_type,size_type> r = equal_range(key);
+		return r.second-r.first;
+	}
+
+	// positions of the keys whose leading components equal the given
+	// prefix (any number of leading components, up to all of them)
+	template<typename... Ps>
+	std::pair<size_type,size_type> equal_range(const Ps &... prefix) const {
+		return equal_range(std::forward_as_tuple(prefix...));
+	}
+
+	template<typename... Ps>
+	std::pair<size_type,size_type>
+	equal_range(const std::tuple<Ps...> &prefix) const {
+		static_assert(sizeof...(Ps)<=ncolumns,"prefix longer than key");
+		std::pair<size_type,size_type> r(0,size());
+		narrow(prefix,r,std::integral_constant<std::size_t,0>());
+		return r;
+	}
+
+	// (narrowing stops at the first column with no match, where the
+	// range start is the insertion point)
+	size_type lower_bound(const key_type &key) const {
+		return equal_range(key).first;
+	}
+
+	// insert & erase:
+
+	std::pair<size_type,bool> insert(const value_type &value) {
+		std::pair<size_type,size_type> r = equal_range(value);
+		if (r.first<r.second) return {r.first,false}; // already present
+		insert_all(r.first,value,indices());
+		return {r.first,true};
+	}
+
+	template<typename inputit>
+	void insert(inputit first, inputit last) {
+		for(;first!=last;++first) insert(*first);
+	}
+
+	void insert(std::initializer_list<value_type> ilist) {
+		for(auto &&x : ilist) insert(x);
+	}
+
+	void erase_at(size_type i) { erase_all(i,indices()); }
+
+	size_type erase(const key_type &key) {
+		size_type i = find(key);
+		if (i==size()) return 0;
+		erase_at(i);
+		return 1;
+	}
+
+	void clear() { clear_all(indices()); }
+
+	// comparisons:
+
+	bool operator==(const mytype &rhs) const {
+		if (size()!=rhs.size()) return false;
+		for(size_type i=0;i<size();i++)
+			if ((*this)[i]!=rhs[i]) return false;
+		return true;
+	}
+	bool operator!=(const mytype &rhs) const {
+		return !(*this==rhs);
+	}
+
+protected:
+
+	using indices = std::index_sequence_for<Ts...>;
+
+	// narrow r to the keys matching prefix on columns C...
+	template<typename P, std::size_t C>
+	void narrow(const P &prefix, std::pair<size_type,size_type> &r,
+			std::integral_constant<std::size_t,C>) const {
+		narrow_step(prefix,r,std::integral_constant<std::size_t,C>(),
+			std::integral_constant<bool,(C<std::tuple_size<P>::value)>());
+	}
+	template<typename P, std::size_t C>
+	void narrow_step(const P &prefix, std::pair<size_type,size_type> &r,
+			std::integral_constant<std::size_t,C>, std::true_type) const {
+		const column_type<C> &col = std::get<C>(_cols);
+		const auto &x = std::get<C>(prefix);
+		size_type lo = col.lower_bound(r.first,r.second,x);
+		r.second = col.upper_bound(lo,r.second,x);
+		r.first = lo;
+		if (r.first==r.second) return;
+		narrow(prefix,r,std::integral_constant<std::size_t,C+1>());
+	}
+	template<typename P, std::size_t C>
+	void narrow_step(const P &, std::pair<size_type,size_type> &,
+			std::integral_constant<std::size_t,C>, std::false_type) const {
+	}
+
+	template<std::size_t... I>
+	key_type get_all(size_type i, std::index_sequence<I...>) const {
+		return key_type(std::get<I>(_cols).get(i)...);
+	}
+	template<std::size_t... I>
+	void insert_all(size_type i, const key_type &key,
+			std::index_sequence<I...>) {
+		int dummy[] = { (std::get<I>(_cols).insert(i,std::get<I>(key)),0)... };
+		(void)dummy;
+	}
+	template<std::size_t... I>
+	void erase_all(size_type i, std::index_sequence<I...>) {
+		int dummy[] = { (std::get<I>(_cols).erase(i),0)... };
+		(void)dummy;
+	}
+	template<std::size_t... I>
+	void clear_all(std::index_sequence<I...>) {
+		int dummy[] = { (std::get<I>(_cols).clear(),0)... };
+		(void)dummy;
+	}
+	template<std::size_t... I>
+	void reserve_all(size_type n, std::index_sequence<I...>) {
+		int dummy[] = { (std::get<I>(_cols).reserve(n),0)... };
+		(void)dummy;
+	}
+	template<std::size_t... I>
+	size_type bytes_all(std::index_sequence<I...>) const {
+		size_type n = 0;
+		int dummy[] = { (n += std::get<I>(_cols).bytes(),0)... };
+		(void)dummy;
+		return n;
+	}
+
+	template<typename S>
+	struct columns;
+	template<std::size_t... I>
+	struct columns<std::index_sequence<I...>> {
+		using type = std::tuple<column_type<I>...>;
+	};
+
+	typename columns<indices>::type _cols;
+
+};
+
+}
+
+#endif
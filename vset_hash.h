@@ -0,0 +1,106 @@
+#ifndef VSET_HASH_H
+#define VSET_HASH_H
+
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+
+namespace sortedvector {
+
+// Content fingerprint shared by vset and vset_ordered: the sum of the
+// mixed std::hash values of the keys.  A sum does not depend on order,
+// so equal sets hash equal whichever container (or insertion order)
+// they come from, and it is updated in O(1) as keys come and go.
+
+// 64-bit finalizer (from splitmix64), so that summing spreads well even
+// for identity-like std::hash
+inline std::size_t mixhash(std::size_t h) {
+	unsigned long long x = h;
+	x ^= x>>30; x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x>>27; x *= 0x94d049bb133111ebULL;
+	x ^= x>>31;
+	return static_cast<std::size_t>(x);
+}
+
+template<typename T, typename = void>
+struct is_hashable : std::false_type {};
+
+template<typename T>
+struct is_hashable<T,decltype(void(
+		std::hash<T>()(std::declval<const T &>())))> : std::true_type {};
+
+// kept only for keys with a usable std::hash; otherwise every
+// operation is a no-op and enabled is false.  Moving from a fingerprint
+// zeroes it, as moving from the set's vector empties that.
+template<typename Key, bool = is_hashable<Key>::value>
+class content_fingerprint {
+public:
+	static constexpr bool enabled = true;
+
+	content_fingerprint() = default;
+	content_fingerprint(const content_fingerprint &) = default;
+	content_fingerprint(content_fingerprint &&f) : _h(f._h) { f._h = 0; }
+	content_fingerprint &operator=(const content_fingerprint &) = default;
+	content_fingerprint &operator=(content_fingerprint &&f) {
+		std::size_t h = f._h;
+		f._h = 0;
+		_h = h;
+		return *this;
+	}
+
+	void add(const Key &k) { _h += mixhash(std::hash<Key>()(k)); }
+	void remove(const Key &k) { _h -= mixhash(std::hash<Key>()(k)); }
+	void clear() { _h = 0; }
+
+	template<typename It>
+	void assign(It first, It last) {
+		_h = 0;
+		for(;first!=last;++first) add(*first);
+	}
+
+	std::size_t value() const { return _h; }
+
+	bool operator==(const content_fingerprint &f) const { return _h==f._h; }
+	bool operator!=(const content_fingerprint &f) const { return _h!=f._h; }
+
+private:
+	std::size_t _h = 0;
+};
+
+template<typename Key>
+class content_fingerprint<Key,false> {
+public:
+	static constexpr bool enabled = false;
+
+	void add(const Key &) {}
+	void remove(const Key &) {}
+	void clear() {}
+
+	template<typename It>
+	void assign(It, It) {}
+
+	bool operator==(const content_fingerprint &) const { return true; }
+	bool operator!=(const content_fingerprint &) const { return false; }
+};
+
+// base of the std::hash specializations for vset and vset_ordered.  For
+// keys without std::hash it cannot be constructed (like std::hash of
+// an unsupported type), so is_hashable is false for a set of such keys
+// and a set of those sets keeps no fingerprint either.
+template<typename Set,
+		bool = content_fingerprint<typename Set::key_type>::enabled>
+struct content_hasher {
+	std::size_t operator()(const Set &s) const { return s.content_hash(); }
+};
+
+template<typename Set>
+struct content_hasher<Set,false> {
+	content_hasher() = delete;
+	content_hasher(const content_hasher &) = delete;
+	content_hasher &operator=(const content_hasher &) = delete;
+};
+
+}
+
+#endif
@@ -6,9 +6,32 @@
 #include <vector>
 #include <utility>
 #include <algorithm>
+#include <type_traits>
+#include <cstddef>
+#include "vset_hash.h"
+#if __cplusplus > 201703L
+#include <span>
+#endif
 
 namespace sortedvector {
 
+template<typename Key, typename Compare, typename Allocator>
+class vset_rebuild;
+
+// default accumulator of vset_ordered::sum_range: wide enough that a
+// range of int keys cannot overflow it in practice
+template<typename T, bool = std::is_floating_point<T>::value,
+		bool = std::is_unsigned<T>::value>
+struct range_sum { using type = long long; };
+
+template<typename T, bool U>
+struct range_sum<T,true,U> {
+	using type = typename std::common_type<T,double>::type;
+};
+
+template<typename T>
+struct range_sum<T,false,true> { using type = unsigned long long; };
+
 template<typename Key, typename Compare = std::less<Key>,
 		typename Allocator = std::allocator<Key>>
 class vset_ordered {
@@ -25,13 +48,33 @@ public:
 	using const_reference = const value_type &;
 	using pointer = typename std::allocator_traits<Allocator>::pointer;
 	using const_pointer = typename std::allocator_traits<Allocator>::const_pointer;
-	using iterator = typename base_type::iterator;
+	// (as with std::set, keys cannot be changed through an iterator)
+	using iterator = typename base_type::const_iterator;
 	using const_iterator = typename base_type::const_iterator;
-	using reverse_iterator = typename base_type::reverse_iterator;
+	using reverse_iterator = typename base_type::const_reverse_iterator;
 	using const_reverse_iterator = typename base_type::const_reverse_iterator;
 
 	using mytype = vset_ordered<Key,Compare,Allocator>;
 
+	// contiguous, read-only view of a run of keys (see range below)
+#if __cplusplus > 201703L
+	using const_span = std::span<const value_type>;
+#else
+	struct const_span {
+		const_span() : _p(nullptr), _n(0) {}
+		const_span(const value_type *p, size_type n) : _p(p), _n(n) {}
+		const value_type *data() const { return _p; }
+		const value_type *begin() const { return _p; }
+		const value_type *end() const { return _p+_n; }
+		size_type size() const { return _n; }
+		bool empty() const { return _n==0; }
+		const value_type &operator[](size_type i) const { return _p[i]; }
+	private:
+		const value_type *_p;
+		size_type _n;
+	};
+#endif
+
 	// constructors:
 	explicit vset_ordered(const Compare & comp = Compare(),
 			const Allocator &alloc = Allocator())
@@ -50,27 +93,33 @@ public:
 	}
 
 	template<class InputIt>
-	vset_ordered(InputIt first, InputIt last, const Allocator &alloc = Allocator() )
+	vset_ordered(InputIt first, InputIt last, const Allocator &alloc)
 			: _comp(Compare()), _v(first,last,alloc) {
 		resort();
 	}
 
 	vset_ordered(const vset_ordered &s) = default;
 	vset_ordered(const vset_ordered &s, const Allocator &alloc)
-			: _comp(s._comp), _v(s._v,alloc) {}
+			: _comp(s._comp), _v(s._v,alloc),
+			  _growth(s._growth), _fp(s._fp) {}
 
 	vset_ordered(vset_ordered &&s) = default;
 	vset_ordered(vset_ordered &&s, const Allocator &alloc)
-		: _comp(std::move(s._comp)), _v(std::move(s._v),alloc) {}
+		: _comp(std::move(s._comp)), _v(std::move(s._v),alloc),
+		  _growth(s._growth), _fp(std::move(s._fp)) {}
 
 	vset_ordered(std::initializer_list<value_type> init,
 			const Compare &comp = Compare(),
 			const Allocator &alloc = Allocator())
-				: _comp(comp), _v(init,alloc) {}
+				: _comp(comp), _v(init,alloc) {
+		resort();
+	}
 	// for C++14, need following
 	vset_ordered(std::initializer_list<value_type> init,
-			const Allocator &alloc = Allocator())
-				: _comp(Compare()), _v(init,alloc) {}
+			const Allocator &alloc)
+				: _comp(Compare()), _v(init,alloc) {
+		resort();
+	}
 
 	// destructor:
 	~vset_ordered() = default;
@@ -80,7 +129,8 @@ public:
 	mytype &operator=(mytype &&) = default;
 	mytype &operator=(std::initializer_list<value_type> ilist) {
 		_v = ilist;
-		resort;
+		resort();
+		return *this;
 	}
 
 	// other functions:
@@ -89,6 +139,8 @@ public:
 	void swap(vset_ordered &s) {
 		std::swap(_comp,s._comp);
 		_v.swap(s._v);
+		std::swap(_growth,s._growth);
+		std::swap(_fp,s._fp);
 	}
 
 	size_type count(const Key &key) const {
@@ -101,12 +153,16 @@ public:
 	value_compare value_comp() const { return _comp; }
 
 	// comparisons:
-	
+	//
+	// For hashable keys, equality rejects on the content fingerprint
+	// in O(1) before comparing the arrays.
+
 	bool operator==(const mytype &rhs) const {
+		if (_v.size()!=rhs._v.size() || _fp!=rhs._fp) return false;
 		return _v==rhs._v;
 	}
 	bool operator!=(const mytype &rhs) const {
-		return _v!=rhs._v;
+		return !(*this==rhs);
 	}
 	bool operator<(const mytype &rhs) const {
 		return _v<rhs._v;
@@ -121,40 +177,52 @@ public:
 		return _v>=rhs._v;
 	}
 
+	// order-independent hash of the contents (see vset_hash.h), kept up
+	// to date by insert and erase; O(1), and equal to vset's for the
+	// same keys
+	std::size_t content_hash() const {
+		static_assert(content_fingerprint<Key>::enabled,
+				"content_hash requires std::hash<Key>");
+		return _fp.value();
+	}
+
 	// for C++14 need to add templated count (only for compares that
 	//  for which Compare::is_transparent is valid) -- not quite sure how
 
 	// removal:
-	void clear() { _v.clear(); }
+	void clear() { _fp.clear(); _v.clear(); }
 
 	iterator erase(const_iterator pos) {
+		_fp.remove(*pos);
 		return _v.erase(pos);
 	}
 
 	//iterator erase(const_iterator first, const_iterator last) {
 	iterator erase(iterator first, iterator last) {
+		for(const_iterator i=first;i!=last;++i) _fp.remove(*i);
 		return _v.erase(first,last);
 	}
 
 	size_type erase(const key_type &key) {
 		std::pair<iterator,iterator> r
 			= std::equal_range(_v.begin(),_v.end(),key,_comp);
+		size_type n = r.second-r.first;
 		erase(r.first,r.second);
-		return r.second-r.first;
+		return n;
 	}
 
 	// iterators:
 	iterator begin() { return _v.begin(); }
 	const_iterator begin() const { return _v.begin(); }
 	const_iterator vbegin() const { return _v.cbegin(); }
-	iterator rbegin() { return _v.rbegin(); }
-	const_iterator rbegin() const { return _v.rbegin(); }
+	reverse_iterator rbegin() { return _v.crbegin(); }
+	const_reverse_iterator rbegin() const { return _v.crbegin(); }
 
 	iterator end() { return _v.end(); }
 	const_iterator end() const { return _v.end(); }
 	const_iterator vend() const { return _v.cend(); }
-	iterator rend() { return _v.rend(); }
-	const_iterator rend() const { return _v.rend(); }
+	reverse_iterator rend() { return _v.crend(); }
+	const_reverse_iterator rend() const { return _v.crend(); }
 
 	// size functions:
 
@@ -164,6 +232,34 @@ public:
 	
 	void shrink_to_fit() { _v.shrink_to_fit(); }
 
+	// capacity & growth:
+	//
+	// A full set grows its capacity by a factor (2 by default).  Growing
+	// always reallocates and copies the whole array, so for very large
+	// sets the way to avoid that spike is to reserve the expected maximum
+	// up front.  With vm_allocator (vm_allocator.h) such a reservation
+	// only takes address space: pages are backed as they are filled, and
+	// no copy happens until the reservation is exceeded.
+
+	void reserve(size_type n) { _v.reserve(n); }
+	size_type capacity() const { return _v.capacity(); }
+
+	// A smaller factor lowers the peak during a reallocation (old and
+	// new arrays together: 1+factor times the size) at the cost of more
+	// frequent copies.  Factors at or below 1.0, which would grow one key
+	// at a time, are raised to 1.01.
+	void set_growth(double factor) {
+		_growth = factor>1.01 ? factor : 1.01;
+	}
+	double growth_factor() const { return _growth; }
+
+	// bytes of capacity not holding keys.  With vm_allocator, the unused
+	// part of a reservation is mostly address space, not memory: it only
+	// counts against memory where keys were once stored and since erased
+	size_type slack_bytes() const {
+		return (_v.capacity()-_v.size())*sizeof(value_type);
+	}
+
 	// find:
 	
 	iterator find(const Key &key) {
@@ -198,6 +294,70 @@ public:
 	const_iterator upper_bound(const Key &key) const {
 		return std::upper_bound(_v.begin(),_v.end(),key,_comp);
 	}
+
+	// range queries:
+	//
+	// all keys k with a <= k <= b (as ordered by the comparison), handed
+	// out as a pointer span into the underlying storage.  The span is
+	// invalidated by anything that would invalidate an iterator.
+	// The scans below walk that span directly with plain pointer loops
+	// (no iterator abstraction, no early exits) so that the compiler
+	// can vectorize them for arithmetic keys.
+
+	const_span range(const Key &a, const Key &b) const {
+		if (_comp(b,a)) return const_span();
+		const_iterator first = std::lower_bound(_v.begin(),_v.end(),a,_comp);
+		const_iterator last = std::upper_bound(first,_v.end(),b,_comp);
+		return const_span(_v.data()+(first-_v.begin()),last-first);
+	}
+
+	template<typename F>
+	F for_each_in_range(const Key &a, const Key &b, F f) const {
+		const_span r = range(a,b);
+		const value_type *p = r.data(), *e = p+r.size();
+		for(;p!=e;++p) f(*p);
+		return f;
+	}
+
+	template<typename Pred>
+	size_type count_if_in_range(const Key &a, const Key &b, Pred pred) const {
+		const_span r = range(a,b);
+		const value_type *p = r.data(), *e = p+r.size();
+		size_type n = 0;
+		for(;p!=e;++p) n += pred(*p) ? 1 : 0;
+		return n;
+	}
+
+	// Sum accumulates in four independent lanes so that floating point
+	// sums (which the compiler may not reassociate) still vectorize.
+	// The result may therefore differ in rounding from a serial sum.
+	// Sum defaults to long long (unsigned long long for unsigned keys)
+	// or, for floating point keys, at least double.
+	template<typename Sum = typename range_sum<value_type>::type>
+	Sum sum_range(const Key &a, const Key &b) const {
+		static_assert(std::is_arithmetic<value_type>::value
+					&& std::is_arithmetic<Sum>::value,
+				"sum_range requires arithmetic keys");
+		const_span r = range(a,b);
+		const value_type *p = r.data();
+		size_type n = r.size(), i = 0;
+		Sum s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+		for(;i+4<=n;i+=4) {
+			s0 += p[i]; s1 += p[i+1];
+			s2 += p[i+2]; s3 += p[i+3];
+		}
+		for(;i<n;i++) s0 += p[i];
+		return (s0+s1)+(s2+s3);
+	}
+
+	// copies the keys in [a,b] to out (which must have room), returning
+	// the end of the copied run.  Trivially copyable keys copied to a
+	// pointer become a single memmove.
+	template<typename OutputIt>
+	OutputIt copy_range_to(const Key &a, const Key &b, OutputIt out) const {
+		const_span r = range(a,b);
+		return std::copy(r.data(),r.data()+r.size(),out);
+	}
 	
 	// for C++14 need to add templated find, equal_range, lower_bound,
 	// and upper_bound
@@ -214,75 +374,75 @@ public:
 
 	std::pair<iterator,bool> insert(const value_type &value) {
 		iterator loc = std::lower_bound(_v.begin(),_v.end(),value,_comp);
-		if (loc!=_v.end() && _comp(*loc,value)) return {loc,false};
-		return {_v.insert(loc,value),true};
+		if (loc!=_v.end() && !_comp(value,*loc)) return {loc,false};
+		return {place(loc,value),true};
 	}
 
 	std::pair<iterator,bool> insert(value_type &&value) {
 		iterator loc = std::lower_bound(_v.begin(),_v.end(),value,_comp);
-		if (loc!=_v.end() && _comp(*loc,value)) return {loc,false};
-		return {_v.insert(loc,std::move(value)),true};
+		if (loc!=_v.end() && !_comp(value,*loc)) return {loc,false};
+		return {place(loc,std::move(value)),true};
 	}
 
 	iterator insert(const_iterator hint, const value_type &value) {
-		if (_v.empty()) return _v.insert(_v.end(),value);
+		if (_v.empty()) return place(_v.end(),value);
 		if (hint==_v.begin()) {
-			if (_comp(value,*hint)) return _v.insert(hint,value);
+			if (_comp(value,*hint)) return place(hint,value);
 			if (_comp(*hint,value)) {
 				++hint;
 				if (hint==_v.end() || _comp(value,*hint))
-					return _v.insert(hint,value);
+					return place(hint,value);
 				else return insert(value).first;
 			} else return hint; // equal...
 		} else if (hint==_v.end()) {
 			--hint;
 			if (_comp(*hint,value))
-				return _v.insert(_v.end(),value);
+				return place(_v.end(),value);
 			if (_comp(value,*hint))
 				return insert(value).first;
-			else return _v.end(); // equal...
+			else return hint; // equal...
 		} else {
 			if (_comp(value,*hint)) {
 				--hint;
 				if (_comp(*hint,value))
-					return _v.insert(++hint,value);
+					return place(++hint,value);
 				else return insert(value).first;
 			} else if (_comp(*hint,value)) {
 				++hint;
 				if (hint==_v.end() || _comp(value,*hint))
-					return _v.insert(hint,value);
+					return place(hint,value);
 				else return insert(value).first;
 			} else return hint; // equal...
 		}
 	}
 	
 	iterator insert(const_iterator hint, value_type &&value) {
-		if (_v.empty()) return _v.insert(_v.end(),std::move(value));
+		if (_v.empty()) return place(_v.end(),std::move(value));
 		if (hint==_v.begin()) {
-			if (_comp(value,*hint)) return _v.insert(hint,std::move(value));
+			if (_comp(value,*hint)) return place(hint,std::move(value));
 			if (_comp(*hint,value)) {
 				++hint;
 				if (hint==_v.end() || _comp(value,*hint))
-					return _v.insert(hint,std::move(value));
+					return place(hint,std::move(value));
 				else return insert(std::move(value)).first;
 			} else return hint; // equal...
 		} else if (hint==_v.end()) {
 			--hint;
 			if (_comp(*hint,value))
-				return _v.insert(_v.end(),std::move(value));
+				return place(_v.end(),std::move(value));
 			if (_comp(value,*hint))
 				return insert(std::move(value)).first;
-			else return _v.end(); // equal...
+			else return hint; // equal...
 		} else {
 			if (_comp(value,*hint)) {
 				--hint;
 				if (_comp(*hint,value))
-					return _v.insert(++hint,std::move(value));
+					return place(++hint,std::move(value));
 				else return insert(std::move(value)).first;
 			} else if (_comp(*hint,value)) {
 				++hint;
 				if (hint==_v.end() || _comp(value,*hint))
-					return _v.insert(hint,std::move(value));
+					return place(hint,std::move(value));
 				else return insert(std::move(value)).first;
 			} else return hint; // equal...
 		}
@@ -321,17 +481,54 @@ public:
 		
 protected:
 
+	friend class vset_rebuild<Key,Compare,Allocator>;
+
+	void grow() {
+		if (_v.size()<_v.capacity()) return;
+		size_type n = _v.size();
+		size_type step = static_cast<size_type>(n*(_growth-1.0));
+		if (step<1) step = 1;
+		_v.reserve(n+step);
+	}
+
+	// insert at pos, growing according to the growth policy first
+	// (pos is held as an offset across the possible reallocation)
+	template<typename V>
+	iterator place(const_iterator pos, V &&value) {
+		difference_type i = pos-_v.cbegin();
+		grow();
+		_fp.add(value);
+		return _v.insert(_v.begin()+i,std::forward<V>(value));
+	}
+
+	// (blocks for the whole sort; see vset_rebuild for an incremental
+	// alternative on large inputs)
 	void resort() {
 		std::sort(_v.begin(),_v.end(),_comp);
+		_v.erase(std::unique(_v.begin(),_v.end(),
+				[this](const Key &a, const Key &b) {
+					return !_comp(a,b) && !_comp(b,a); }),
+			_v.end());
+		_fp.assign(_v.begin(),_v.end());
 	}
 
 	Compare _comp;
 	base_type _v;
+	double _growth = 2.0;
+	content_fingerprint<Key> _fp;
 
 };
 
 
 
+}
+
+namespace std {
+	template<typename Key, typename Compare, typename Allocator>
+	struct hash<sortedvector::vset_ordered<Key,Compare,Allocator>>
+		: sortedvector::content_hasher<
+			sortedvector::vset_ordered<Key,Compare,Allocator>> {
+	};
 }
 
 #endif
@@ -0,0 +1,283 @@
+#ifndef VSET_REBUILD_H
+#define VSET_REBUILD_H
+
+#include "vset_ordered.h"
+#include <functional>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <limits>
+
+namespace sortedvector {
+
+// Incremental (re)build of a vset_ordered from unsorted keys.
+//
+// Building a vset_ordered from a range sorts everything at once, which
+// for very large inputs stalls the caller for seconds.  A vset_rebuild
+// instead does the same work -- a bottom-up merge sort, an optional
+// merge with the set's current contents, and removal of duplicates --
+// in slices of bounded size.  Destroying the moved-from scratch
+// elements between passes is also done in budgeted pieces, so a slice
+// stays bounded for keys with non-trivial destructors:
+//
+//	vset_rebuild<Key> rb(s,std::move(keys));
+//	while(!rb.step_for(std::chrono::microseconds(200)))
+//		... serve queries from s ...
+//	keys = rb.commit(); // O(1) swap, hands back the old contents
+//
+// The target set is only read (in merge mode) until commit(), so it
+// stays fully queryable throughout.  It must not be modified while the
+// rebuild is in progress: such changes would be lost at commit().
+//
+// Alternatively run_async() finishes the work on a background thread
+// (std::async); poll done() and commit() from the owning thread.
+// step() must not be called while a background run is active.
+
+template<typename Key, typename Compare = std::less<Key>,
+		typename Allocator = std::allocator<Key>>
+class vset_rebuild {
+public:
+	using set_type = vset_ordered<Key,Compare,Allocator>;
+	using base_type = typename set_type::base_type;
+	using size_type = typename set_type::size_type;
+
+	enum mode {
+		replace, // target ends up holding exactly the new keys
+		merge    // target ends up holding its keys and the new ones
+	};
+
+	// keys need not be sorted or unique.  chunk is the length of the
+	// runs sorted directly (and the default step size)
+	vset_rebuild(set_type &target, base_type keys, mode m = replace,
+			size_type chunk = 1<<12)
+				: _target(&target), _comp(target._comp),
+				  _src(std::move(keys)), _dst(_src.get_allocator()),
+				  _mode(m), _chunk(chunk ? chunk : 1),
+				  _phase(sorting), _pos(0), _done(false) {
+	}
+
+	vset_rebuild(const vset_rebuild &) = delete;
+	vset_rebuild &operator=(const vset_rebuild &) = delete;
+
+	// waits for any background run; frees the scratch storage
+	~vset_rebuild() = default;
+
+	// Does about budget elements' worth of work (a directly sorted run
+	// counts its length; merging and deduplication count each element
+	// moved).  Returns true once the result is ready for commit().
+	bool step(size_type budget) {
+		while(budget>0 && _phase!=finished) {
+			size_type done = 0;
+			switch(_phase) {
+				case sorting: done = sortstep(budget); break;
+				case merging: done = mergestep(budget); break;
+				case joining: done = joinstep(budget); break;
+				case dedup: done = dedupstep(budget); break;
+				case trimming: done = trimstep(budget); break;
+				case finished: break;
+			}
+			budget = done<budget ? budget-done : 0;
+		}
+		if (_phase==finished) _done.store(true,std::memory_order_release);
+		return _phase==finished;
+	}
+
+	// steps (in chunk-sized pieces) until slice has elapsed
+	template<typename Rep, typename Period>
+	bool step_for(std::chrono::duration<Rep,Period> slice) {
+		auto stop = std::chrono::steady_clock::now()+slice;
+		while(!step(_chunk))
+			if (std::chrono::steady_clock::now()>=stop) return false;
+		return true;
+	}
+
+	// finishes the remaining work on another thread
+	void run_async() {
+		if (_bg.valid() || done()) return;
+		_bg = std::async(std::launch::async,[this]() {
+			step(std::numeric_limits<size_type>::max());
+		});
+	}
+
+	bool done() const { return _done.load(std::memory_order_acquire); }
+
+	// Swaps the result into the target (finishing the work first, in
+	// the calling thread or by waiting for the background run, if it is
+	// not done yet) and returns the target's old contents.  Destroying
+	// those is O(n), so the caller chooses where that happens (later, or
+	// on another thread).  The (by now empty) scratch buffer's storage
+	// is freed when the vset_rebuild is destroyed.
+	base_type commit() {
+		if (_bg.valid()) _bg.get();
+		step(std::numeric_limits<size_type>::max());
+		_target->_v.swap(_src);
+		_target->_fp = _fp;
+		base_type old(std::move(_src));
+		return old;
+	}
+
+private:
+
+	enum phase { sorting, merging, joining, dedup, trimming, finished };
+	using next_type = phase (vset_rebuild::*)();
+
+	// sort the next chunk-sized run of _src in place
+	size_type sortstep(size_type) {
+		size_type n = _src.size();
+		if (_pos>=n) {
+			_width = _chunk;
+			_phase = startmerge();
+			return 0;
+		}
+		size_type e = std::min(n,_pos+_chunk);
+		std::sort(_src.begin()+_pos,_src.begin()+e,_comp);
+		size_type len = e-_pos;
+		_pos = e;
+		return len;
+	}
+
+	// one bottom-up merge pass of run pairs of width _width from _src
+	// into _dst (which is empty), resumable in the middle of a pair
+	phase startmerge() {
+		_pos = 0;
+		_a = _b = _be = 0;
+		_inpair = false;
+		if (_width>=_src.size()) return startjoin();
+		_dst.reserve(_src.size());
+		return merging;
+	}
+
+	phase nextpass() {
+		_width *= 2;
+		return startmerge();
+	}
+
+	size_type mergestep(size_type budget) {
+		size_type n = _src.size();
+		if (!_inpair) {
+			if (_pos>=n) {
+				_src.swap(_dst);
+				return trim(_dst,0,&vset_rebuild::nextpass);
+			}
+			_a = _pos;
+			_ae = std::min(n,_pos+_width);
+			_b = _ae;
+			_be = std::min(n,_pos+2*_width);
+			_inpair = true;
+		}
+		size_type done = mergeinto(_src,_a,_ae,_src,_b,_be,budget);
+		if (_a==_ae && _b==_be) {
+			_inpair = false;
+			_pos = _be;
+		}
+		return done;
+	}
+
+	// merge the (sorted) new keys with the target's current contents,
+	// which are copied, not moved, so the target stays intact
+	phase startjoin() {
+		if (_mode!=merge || _target->_v.empty()) return startdedup();
+		_dst.reserve(_src.size()+_target->_v.size());
+		_a = 0;
+		_ae = _target->_v.size();
+		_b = 0;
+		_be = _src.size();
+		return joining;
+	}
+
+	size_type joinstep(size_type budget) {
+		const base_type &old = _target->_v;
+		size_type done = mergeinto(old,_a,_ae,_src,_b,_be,budget);
+		if (_a==_ae && _b==_be) {
+			_src.swap(_dst);
+			trim(_dst,0,&vset_rebuild::startdedup);
+		}
+		return done;
+	}
+
+	// drop equivalent neighbours in place: _a reads, _b writes (and the
+	// target's content fingerprint is built from the keys kept)
+	phase startdedup() {
+		_fp.clear();
+		if (!_src.empty()) _fp.add(_src[0]);
+		_a = _b = _src.empty() ? 0 : 1;
+		return _src.empty() ? finished : dedup;
+	}
+
+	size_type dedupstep(size_type budget) {
+		size_type n = _src.size();
+		size_type e = _a+std::min(budget,n-_a);
+		size_type len = e-_a;
+		for(;_a<e;++_a) {
+			const Key &last = _src[_b-1];
+			if (_comp(last,_src[_a]) || _comp(_src[_a],last)) {
+				if (_a!=_b) _src[_b] = std::move(_src[_a]);
+				_fp.add(_src[_b]);
+				++_b;
+			}
+		}
+		if (_a==n) trim(_src,_b,&vset_rebuild::finish);
+		return len ? len : 1;
+	}
+
+	phase finish() { return finished; }
+
+	// destroy the elements of v beyond to (budget at a time, from the
+	// back), then continue with next
+	size_type trim(base_type &v, size_type to, next_type next) {
+		_trimv = &v;
+		_trimto = to;
+		_next = next;
+		_phase = trimming;
+		return 0;
+	}
+
+	size_type trimstep(size_type budget) {
+		size_type n = std::min(budget,_trimv->size()-_trimto);
+		_trimv->erase(_trimv->end()-n,_trimv->end());
+		if (_trimv->size()==_trimto) _phase = (this->*_next)();
+		return n ? n : 1;
+	}
+
+	// appends up to budget elements of the merge of x[xi,xe) and
+	// y[yi,ye) to _dst (moving from y, and from x unless it is the
+	// target's storage), advancing xi and yi; returns the count
+	template<typename X>
+	size_type mergeinto(X &x, size_type &xi, size_type xe,
+			base_type &y, size_type &yi, size_type ye, size_type budget) {
+		size_type done = 0;
+		for(;done<budget && xi<xe && yi<ye;++done)
+			if (_comp(y[yi],x[xi])) _dst.push_back(std::move(y[yi++]));
+			else _dst.push_back(take(x[xi++]));
+		for(;done<budget && xi<xe;++done) _dst.push_back(take(x[xi++]));
+		for(;done<budget && yi<ye;++done) _dst.push_back(std::move(y[yi++]));
+		return done ? done : 1;
+	}
+
+	static Key &&take(Key &k) { return std::move(k); }
+	static const Key &take(const Key &k) { return k; }
+
+	set_type *_target;
+	Compare _comp;
+	base_type _src, _dst;
+	mode _mode;
+	size_type _chunk;
+	phase _phase;
+	size_type _pos, _width = 0;
+	size_type _a = 0, _ae = 0, _b = 0, _be = 0;
+	bool _inpair = false;
+	base_type *_trimv = nullptr;
+	size_type _trimto = 0;
+	next_type _next = nullptr;
+	content_fingerprint<Key> _fp;
+	std::atomic<bool> _done;
+	std::future<void> _bg;
+};
+
+}
+
+#endif